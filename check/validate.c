@@ -0,0 +1,508 @@
+/*
+** Native validation harness for the d2q9-bgk kernels.
+**
+** Runs the timestep() built from ../d2q9-bgk.c side by side with a frozen
+** copy of the original serial kernel, ref_timestep(), for a short number
+** of steps on each of the reference sets in check/.  After every step it
+**
+**   - compares every speed of every cell against the reference grid,
+**     accepting a value within VALIDATE_MAX_ULP units in the last place
+**     or VALIDATE_RTOL relative error,
+**   - compares the average velocity against ref_timestep() in the same way,
+**     and against the reference av_vels file within VALIDATE_AV_RTOL,
+**   - checks mass conservation: total_density() must match that of the
+**     reference grid within VALIDATE_MASS_RTOL, and drift no further than
+**     VALIDATE_MASS_DRIFT from its initial value.  Single precision
+**     rounding makes even the reference kernel drift slightly.
+**
+** Kernel variants are selected the same way as for the main executable,
+** through CFLAGS, e.g.:
+**
+**   make validate CFLAGS="-std=c99 -Wall -Ofast -march=native -DOUT_OF_CORE"
+**
+** Usage, from the top-level directory:
+**
+**   ./check/validate [steps] [set ...]
+**
+** (or `make validate`)
+**
+** where a set is a grid size such as 128x128, naming input_<set>.params,
+** obstacles_<set>.dat and check/<set>.av_vels.dat.  With no sets given
+** all four reference sets are run.  Exits non-zero if any check fails.
+*/
+
+#define NO_MAIN
+#include "../d2q9-bgk.c"
+
+#include <stdint.h>
+
+#ifndef VALIDATE_STEPS
+#define VALIDATE_STEPS 100 /* default number of steps per set */
+#endif
+#ifndef VALIDATE_MAX_ULP
+#define VALIDATE_MAX_ULP 64 /* max. distance in units in the last place */
+#endif
+#ifndef VALIDATE_RTOL
+#define VALIDATE_RTOL 1e-5 /* relative tolerance against ref_timestep() */
+#endif
+#ifndef VALIDATE_AV_RTOL
+#define VALIDATE_AV_RTOL 1e-3 /* relative tolerance against av_vels files */
+#endif
+#ifndef VALIDATE_MASS_RTOL
+#define VALIDATE_MASS_RTOL 1e-5 /* relative tolerance on total density */
+#endif
+#ifndef VALIDATE_MASS_DRIFT
+#define VALIDATE_MASS_DRIFT 1e-2 /* relative total density drift allowed */
+#endif
+#ifndef VALIDATE_MAX_REPORTS
+#define VALIDATE_MAX_REPORTS 10 /* failures printed per set */
+#endif
+
+/* struct to hold the worst differences seen in a set */
+typedef struct {
+  int64_t max_ulp;  /* largest ULP distance seen */
+  double max_rel;   /* largest relative error seen */
+  double max_av;    /* largest relative error against the av_vels file */
+  double max_mass;  /* largest relative error in total density */
+  double max_drift; /* largest relative drift in total density */
+  long failures;    /* no. of values outside tolerance */
+} t_diff;
+
+/* the original serial kernel, kept as the reference */
+float ref_timestep(const t_param params, t_speed *cells, t_speed *tmp_cells,
+                   int *obstacles);
+void ref_accelerate_flow(const t_param params, t_speed *cells, int *obstacles);
+
+/* run one reference set, returning the no. of failed checks */
+long validate_set(const char *set, int steps);
+
+/* compare a value against its reference, updating the running differences;
+** returns 1 if it is within tolerance */
+int compare_value(float value, float ref, t_diff *diff);
+
+/* distance between two floats in units in the last place */
+int64_t ulp_distance(float a, float b);
+
+/* 1 if x is NaN or infinite, judged from its bit pattern since -Ofast
+** lets the compiler assume isnan() and isinf() are always false */
+int non_finite(float x);
+
+/* read the first steps values of a reference av_vels file */
+float *read_av_vels(const char *filename, int steps);
+
+int main(int argc, char *argv[]) {
+  const char *default_sets[] = {"128x128", "128x256", "256x256",
+                                "1024x1024"};
+  const int n_default_sets = sizeof(default_sets) / sizeof(default_sets[0]);
+  int steps = VALIDATE_STEPS;
+  long failures = 0;
+
+  if (argc > 1) {
+    steps = atoi(argv[1]);
+
+    if (steps <= 0) {
+      fprintf(stderr, "Usage: %s [steps] [set ...]\n", argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (argc > 2) {
+    for (int ii = 2; ii < argc; ii++)
+      failures += validate_set(argv[ii], steps);
+  } else {
+    for (int ii = 0; ii < n_default_sets; ii++)
+      failures += validate_set(default_sets[ii], steps);
+  }
+
+  if (failures) {
+    printf("Validation FAILED: %ld value(s) outside tolerance\n", failures);
+    return EXIT_FAILURE;
+  }
+
+  printf("All sets passed!\n");
+
+  return EXIT_SUCCESS;
+}
+
+long validate_set(const char *set, int steps) {
+  char paramfile[256];    /* input parameter file for this set */
+  char obstaclefile[256]; /* obstacle file for this set */
+  char avvelsfile[256];   /* reference av_vels file for this set */
+  t_param params;         /* struct to hold parameter values */
+  t_arena arena;          /* mapping holding the kernel's buffers */
+  t_speed *cells = NULL;  /* grid advanced by the kernel under test */
+  t_speed *tmp_cells = NULL;
+  int *obstacles = NULL;
+  float *av_vels = NULL;
+  t_diff diff = {0, 0.0, 0.0, 0.0, 0.0, 0};
+
+  if (snprintf(paramfile, sizeof(paramfile), "input_%s.params", set) >=
+          (int)sizeof(paramfile) ||
+      snprintf(obstaclefile, sizeof(obstaclefile), "obstacles_%s.dat", set) >=
+          (int)sizeof(obstaclefile) ||
+      snprintf(avvelsfile, sizeof(avvelsfile), "check/%s.av_vels.dat", set) >=
+          (int)sizeof(avvelsfile))
+    die("reference set name too long", __LINE__, __FILE__);
+
+  initialise(paramfile, obstaclefile, &params, &arena, &cells, &tmp_cells,
+             &obstacles, &av_vels);
+
+  if (steps > params.maxIters)
+    steps = params.maxIters;
+
+  float *ref_av_vels = read_av_vels(avvelsfile, steps);
+
+  /* the reference kernel gets its own copy of the initial grid */
+  const size_t cells_bytes =
+      sizeof(t_speed) * ((size_t)params.ny * params.nx);
+  t_speed *ref_cells = (t_speed *)malloc(cells_bytes);
+  t_speed *ref_tmp_cells = (t_speed *)malloc(cells_bytes);
+
+  if (ref_cells == NULL || ref_tmp_cells == NULL)
+    die("cannot allocate memory for reference cells", __LINE__, __FILE__);
+
+  memcpy(ref_cells, cells, cells_bytes);
+
+  const float initial_mass = total_density(params, cells);
+
+  for (int tt = 0; tt < steps; tt++) {
+    av_vels[tt] = timestep(params, cells, tmp_cells, obstacles);
+    t_speed *swap_pointer = tmp_cells;
+    tmp_cells = cells;
+    cells = swap_pointer;
+
+    float ref_av = ref_timestep(params, ref_cells, ref_tmp_cells, obstacles);
+    swap_pointer = ref_tmp_cells;
+    ref_tmp_cells = ref_cells;
+    ref_cells = swap_pointer;
+
+    /* every speed of every cell */
+    for (int jj = 0; jj < params.ny; jj++) {
+      for (int ii = 0; ii < params.nx; ii++) {
+        for (int kk = 0; kk < NSPEEDS; kk++) {
+          float value = cells[ii + jj * params.nx].speeds[kk];
+          float ref = ref_cells[ii + jj * params.nx].speeds[kk];
+
+          if (!compare_value(value, ref, &diff) &&
+              diff.failures <= VALIDATE_MAX_REPORTS) {
+            printf("  %s step %d: cell (%d,%d) speed %d: %.12E vs. %.12E\n",
+                   set, tt, ii, jj, kk, value, ref);
+          }
+        }
+      }
+    }
+
+    /* average velocity against the reference kernel */
+    if (!compare_value(av_vels[tt], ref_av, &diff) &&
+        diff.failures <= VALIDATE_MAX_REPORTS) {
+      printf("  %s step %d: av velocity %.12E vs. %.12E\n", set, tt,
+             av_vels[tt], ref_av);
+    }
+
+    /* average velocity against the reference results */
+    double av_rel =
+        fabs((double)av_vels[tt] - ref_av_vels[tt]) / fabs(ref_av_vels[tt]);
+
+    /* a non-finite error is kept, so the summary shows it */
+    if (non_finite(av_vels[tt]) || av_rel > diff.max_av)
+      diff.max_av = av_rel;
+
+    /* written as !(x <= tol) so that a NaN error fails */
+    if ((non_finite(av_vels[tt]) || !(av_rel <= VALIDATE_AV_RTOL)) &&
+        ++diff.failures <= VALIDATE_MAX_REPORTS) {
+      printf("  %s step %d: av velocity %.12E vs. reference %.12E\n", set, tt,
+             av_vels[tt], ref_av_vels[tt]);
+    }
+
+    /* mass conservation */
+    float mass = total_density(params, cells);
+    float ref_mass = total_density(params, ref_cells);
+    double mass_rel = fabs((double)mass - ref_mass) / ref_mass;
+    double drift = fabs((double)mass - initial_mass) / initial_mass;
+
+    if (non_finite(mass) || mass_rel > diff.max_mass)
+      diff.max_mass = mass_rel;
+
+    if (non_finite(mass) || drift > diff.max_drift)
+      diff.max_drift = drift;
+
+    if ((non_finite(mass) || !(mass_rel <= VALIDATE_MASS_RTOL)) &&
+        ++diff.failures <= VALIDATE_MAX_REPORTS) {
+      printf("  %s step %d: total density %.12E vs. %.12E\n", set, tt, mass,
+             ref_mass);
+    }
+
+    if ((non_finite(mass) || !(drift <= VALIDATE_MASS_DRIFT)) &&
+        ++diff.failures <= VALIDATE_MAX_REPORTS) {
+      printf("  %s step %d: total density %.12E vs. initial %.12E\n", set, tt,
+             mass, initial_mass);
+    }
+  }
+
+  printf("%-10s %d steps: max ULP %lld, max rel. error %.3E, "
+         "max av_vels error %.3E, max mass error %.3E (drift %.3E): %s\n",
+         set, steps, (long long)diff.max_ulp, diff.max_rel, diff.max_av,
+         diff.max_mass, diff.max_drift,
+         diff.failures ? "FAILED"
+                       : (diff.max_ulp == 0 ? "passed (bit-for-bit)"
+                                            : "passed"));
+
+  free(ref_cells);
+  free(ref_tmp_cells);
+  free(ref_av_vels);
+  finalise(&params, &arena, &cells, &tmp_cells, &obstacles, &av_vels);
+
+  return diff.failures;
+}
+
+int compare_value(float value, float ref, t_diff *diff) {
+  int64_t ulp = ulp_distance(value, ref);
+  double rel = (ref == 0.f) ? fabs((double)value)
+                            : fabs((double)value - ref) / fabs((double)ref);
+
+  if (ulp > diff->max_ulp)
+    diff->max_ulp = ulp;
+
+  if (non_finite(value) || rel > diff->max_rel)
+    diff->max_rel = rel;
+
+  /* a NaN or infinity never matches, whatever its distance */
+  if (non_finite(value) ||
+      (ulp > VALIDATE_MAX_ULP && !(rel <= VALIDATE_RTOL))) {
+    ++diff->failures;
+    return 0;
+  }
+
+  return 1;
+}
+
+int64_t ulp_distance(float a, float b) {
+  int32_t ia, ib;
+
+  memcpy(&ia, &a, sizeof(ia));
+  memcpy(&ib, &b, sizeof(ib));
+
+  /* map sign-magnitude onto a monotonic integer line */
+  if (ia < 0)
+    ia = INT32_MIN - ia;
+  if (ib < 0)
+    ib = INT32_MIN - ib;
+
+  return (ia > ib) ? (int64_t)ia - ib : (int64_t)ib - ia;
+}
+
+int non_finite(float x) {
+  uint32_t bits;
+
+  memcpy(&bits, &x, sizeof(bits));
+
+  /* an all-ones exponent encodes both NaN and infinity */
+  return (bits & 0x7f800000u) == 0x7f800000u;
+}
+
+float *read_av_vels(const char *filename, int steps) {
+  char message[1024]; /* message buffer */
+  FILE *fp;           /* file pointer */
+  int step;           /* step number read from the file */
+  float *av_vels = (float *)malloc(sizeof(float) * steps);
+
+  if (av_vels == NULL)
+    die("cannot allocate memory for reference av_vels", __LINE__, __FILE__);
+
+  fp = fopen(filename, "r");
+
+  if (fp == NULL) {
+    sprintf(message, "could not open reference av_vels file: %s", filename);
+    die(message, __LINE__, __FILE__);
+  }
+
+  for (int tt = 0; tt < steps; tt++) {
+    if (fscanf(fp, "%d:\t%f\n", &step, &av_vels[tt]) != 2 || step != tt) {
+      sprintf(message, "could not read step %d of reference av_vels file: %s",
+              tt, filename);
+      die(message, __LINE__, __FILE__);
+    }
+  }
+
+  fclose(fp);
+
+  return av_vels;
+}
+
+float ref_timestep(const t_param params, t_speed *cells,
+                   t_speed *tmp_cells, int *obstacles) {
+  ref_accelerate_flow(params, cells, obstacles);
+  int tot_cells = 0; /* no. of cells used in calculation */
+  float tot_u = 0.f; /* accumulated magnitudes of velocity for each cell */
+  for (int jj = 0; jj < params.ny; jj++) {
+    for (int ii = 0; ii < params.nx; ii++) {
+      // Propagate ------
+      int y_n = (jj + 1) % params.ny;
+      int x_e = (ii + 1) % params.nx;
+      int y_s = (jj == 0) ? (jj + params.ny - 1) : (jj - 1);
+      int x_w = (ii == 0) ? (ii + params.nx - 1) : (ii - 1);
+      /* propagate densities from neighbouring cells, following
+      ** appropriate directions of travel and writing into
+      ** scratch space grid */
+      tmp_cells[ii + jj * params.nx].speeds[0] =
+          cells[ii + jj * params.nx].speeds[0]; /* central cell, no movement */
+      tmp_cells[ii + jj * params.nx].speeds[1] =
+          cells[x_w + jj * params.nx].speeds[1]; /* east */
+      tmp_cells[ii + jj * params.nx].speeds[2] =
+          cells[ii + y_s * params.nx].speeds[2]; /* north */
+      tmp_cells[ii + jj * params.nx].speeds[3] =
+          cells[x_e + jj * params.nx].speeds[3]; /* west */
+      tmp_cells[ii + jj * params.nx].speeds[4] =
+          cells[ii + y_n * params.nx].speeds[4]; /* south */
+      tmp_cells[ii + jj * params.nx].speeds[5] =
+          cells[x_w + y_s * params.nx].speeds[5]; /* north-east */
+      tmp_cells[ii + jj * params.nx].speeds[6] =
+          cells[x_e + y_s * params.nx].speeds[6]; /* north-west */
+      tmp_cells[ii + jj * params.nx].speeds[7] =
+          cells[x_e + y_n * params.nx].speeds[7]; /* south-west */
+      tmp_cells[ii + jj * params.nx].speeds[8] =
+          cells[x_w + y_n * params.nx].speeds[8]; /* south-east */
+      // ----------------
+      if (obstacles[ii + jj * params.nx]) {
+        // Rebound --------
+        /* called after propagate, so taking values from scratch space
+        ** mirroring, and writing into main grid */
+        float *cell_speeds = tmp_cells[ii + jj * params.nx].speeds;
+        float temp1 = cell_speeds[1];
+        cell_speeds[1] = cell_speeds[3];
+        cell_speeds[3] = temp1;
+        float temp2 = cell_speeds[2];
+        cell_speeds[2] = cell_speeds[4];
+        cell_speeds[4] = temp2;
+        float temp5 = cell_speeds[5];
+        cell_speeds[5] = cell_speeds[7];
+        cell_speeds[7] = temp5;
+        float temp6 = cell_speeds[6];
+        cell_speeds[6] = cell_speeds[8];
+        cell_speeds[8] = temp6;
+        // ----------------
+      } else {
+        // Collision ------
+        const float c_sq = 1.f / 3.f; /* square of speed of sound */
+        const float w0 = 4.f / 9.f;   /* weighting factor */
+        const float w1 = 1.f / 9.f;   /* weighting factor */
+        const float w2 = 1.f / 36.f;  /* weighting factor */
+
+        /* NB the collision step is called after
+        ** the propagate step and so values of interest
+        ** are in the scratch-space grid */
+
+        /* compute local density total */
+        float local_density = 0.f;
+
+        for (int kk = 0; kk < NSPEEDS; kk++) {
+          local_density += tmp_cells[ii + jj * params.nx].speeds[kk];
+        }
+
+        /* compute x velocity component */
+        float u_x = (tmp_cells[ii + jj * params.nx].speeds[1] +
+                     tmp_cells[ii + jj * params.nx].speeds[5] +
+                     tmp_cells[ii + jj * params.nx].speeds[8] -
+                     (tmp_cells[ii + jj * params.nx].speeds[3] +
+                      tmp_cells[ii + jj * params.nx].speeds[6] +
+                      tmp_cells[ii + jj * params.nx].speeds[7])) /
+                    local_density;
+        /* compute y velocity component */
+        float u_y = (tmp_cells[ii + jj * params.nx].speeds[2] +
+                     tmp_cells[ii + jj * params.nx].speeds[5] +
+                     tmp_cells[ii + jj * params.nx].speeds[6] -
+                     (tmp_cells[ii + jj * params.nx].speeds[4] +
+                      tmp_cells[ii + jj * params.nx].speeds[7] +
+                      tmp_cells[ii + jj * params.nx].speeds[8])) /
+                    local_density;
+
+        /* velocity squared */
+        float u_sq = u_x * u_x + u_y * u_y;
+        tot_u += sqrt(u_sq);
+
+        /* directional velocity components */
+        float u[NSPEEDS];
+        u[1] = u_x;        /* east */
+        u[2] = u_y;        /* north */
+        u[3] = -u_x;       /* west */
+        u[4] = -u_y;       /* south */
+        u[5] = u_x + u_y;  /* north-east */
+        u[6] = -u_x + u_y; /* north-west */
+        u[7] = -u_x - u_y; /* south-west */
+        u[8] = u_x - u_y;  /* south-east */
+
+        /* equilibrium densities */
+        float d_equ[NSPEEDS];
+        /* zero velocity density: weight w0 */
+        d_equ[0] = w0 * local_density * (1.f - u_sq / (2.f * c_sq));
+        /* axis speeds: weight w1 */
+        d_equ[1] = w1 * local_density *
+                   (1.f + u[1] / c_sq + (u[1] * u[1]) / (2.f * c_sq * c_sq) -
+                    u_sq / (2.f * c_sq));
+        d_equ[2] = w1 * local_density *
+                   (1.f + u[2] / c_sq + (u[2] * u[2]) / (2.f * c_sq * c_sq) -
+                    u_sq / (2.f * c_sq));
+        d_equ[3] = w1 * local_density *
+                   (1.f + u[3] / c_sq + (u[3] * u[3]) / (2.f * c_sq * c_sq) -
+                    u_sq / (2.f * c_sq));
+        d_equ[4] = w1 * local_density *
+                   (1.f + u[4] / c_sq + (u[4] * u[4]) / (2.f * c_sq * c_sq) -
+                    u_sq / (2.f * c_sq));
+        /* diagonal speeds: weight w2 */
+        d_equ[5] = w2 * local_density *
+                   (1.f + u[5] / c_sq + (u[5] * u[5]) / (2.f * c_sq * c_sq) -
+                    u_sq / (2.f * c_sq));
+        d_equ[6] = w2 * local_density *
+                   (1.f + u[6] / c_sq + (u[6] * u[6]) / (2.f * c_sq * c_sq) -
+                    u_sq / (2.f * c_sq));
+        d_equ[7] = w2 * local_density *
+                   (1.f + u[7] / c_sq + (u[7] * u[7]) / (2.f * c_sq * c_sq) -
+                    u_sq / (2.f * c_sq));
+        d_equ[8] = w2 * local_density *
+                   (1.f + u[8] / c_sq + (u[8] * u[8]) / (2.f * c_sq * c_sq) -
+                    u_sq / (2.f * c_sq));
+
+        /* relaxation step */
+        for (int kk = 0; kk < NSPEEDS; kk++) {
+          tmp_cells[ii + jj * params.nx].speeds[kk] =
+              tmp_cells[ii + jj * params.nx].speeds[kk] +
+              params.omega *
+                  (d_equ[kk] - tmp_cells[ii + jj * params.nx].speeds[kk]);
+        }
+
+        // ----------------
+        ++tot_cells;
+      }
+    }
+  }
+  return tot_u / (float)tot_cells;
+}
+
+void ref_accelerate_flow(const t_param params, t_speed *cells,
+                         int *obstacles) {
+  /* compute weighting factors */
+  float w1 = params.density * params.accel / 9.f;
+  float w2 = params.density * params.accel / 36.f;
+
+  /* modify the 2nd row of the grid */
+  int jj = params.ny - 2;
+
+  for (int ii = 0; ii < params.nx; ii++) {
+    /* if the cell is not occupied and
+    ** we don't send a negative density */
+    if (!obstacles[ii + jj * params.nx] &&
+        (cells[ii + jj * params.nx].speeds[3] - w1) > 0.f &&
+        (cells[ii + jj * params.nx].speeds[6] - w2) > 0.f &&
+        (cells[ii + jj * params.nx].speeds[7] - w2) > 0.f) {
+      /* increase 'east-side' densities */
+      cells[ii + jj * params.nx].speeds[1] += w1;
+      cells[ii + jj * params.nx].speeds[5] += w2;
+      cells[ii + jj * params.nx].speeds[8] += w2;
+      /* decrease 'west-side' densities */
+      cells[ii + jj * params.nx].speeds[3] -= w1;
+      cells[ii + jj * params.nx].speeds[6] -= w2;
+      cells[ii + jj * params.nx].speeds[7] -= w2;
+    }
+  }
+}
+
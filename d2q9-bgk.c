@@ -47,8 +47,30 @@
 **
 ** Be sure to adjust the grid dimensions in the parameter file
 ** if you choose a different obstacle file.
+**
+** All solver buffers are carved out of a single arena mapping, each
+** aligned to ARENA_ALIGN bytes.  The arena is backed by explicit 2 MB
+** huge pages when the hugetlbfs pool has room, otherwise by base pages
+** with transparent huge pages requested.  -DNO_HUGE_PAGES forces base
+** pages, and -DNUMA_INTERLEAVE spreads the arena across all NUMA nodes.
+** The page size and buffer layout are reported at startup.
+**
+** Building with -DOUT_OF_CORE backs the arena with an mmapped file
+** (OOC_FILE) instead of anonymous memory, for grids that do not fit in
+** RAM.  timestep() then walks the grid in slabs of OOC_SLAB_ROWS rows,
+** asking the kernel to read ahead the next slab while the current one is
+** computed.  Each finished tmp_cells slab is written back to the file, and
+** evicted from the page cache one slab later once the write has landed;
+** finished cells and obstacles rows are clean and are evicted at once.
+** Propagation only reads rows jj-1..jj+1, so the resident working set
+** stays at a few slabs.
 */
 
+#define _DEFAULT_SOURCE /* mmap() flags, madvise() and syscall() under c99 */
+#ifdef OUT_OF_CORE
+#define _GNU_SOURCE /* sync_file_range() */
+#endif
+
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -57,10 +79,45 @@
 #include <sys/time.h>
 #include <time.h>
 
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef OUT_OF_CORE
+#include <fcntl.h>
+#endif
+
+#ifdef NUMA_INTERLEAVE
+#include <sys/syscall.h>
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3 /* from <linux/mempolicy.h> */
+#endif
+#endif
+
 #define NSPEEDS 9
 #define FINALSTATEFILE "final_state.dat"
 #define AVVELSFILE "av_vels.dat"
 
+#ifndef ARENA_ALIGN
+#define ARENA_ALIGN 64 /* alignment of each buffer in the arena */
+#endif
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26 /* from <linux/mman.h> */
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT) /* log2(HUGE_PAGE_SIZE) */
+#endif
+
+#ifdef OUT_OF_CORE
+#ifndef OOC_FILE
+#define OOC_FILE "lattice.ooc" /* backing file name prefix */
+#endif
+#ifndef OOC_SLAB_ROWS
+#define OOC_SLAB_ROWS 64 /* grid rows streamed per slab */
+#endif
+#endif
+
 /* struct to hold the parameter values */
 typedef struct {
   int nx;           /* no. of cells in x-direction */
@@ -77,6 +134,16 @@ typedef struct {
   float speeds[NSPEEDS];
 } t_speed;
 
+/* struct to hold the single mapping all solver buffers are carved from */
+typedef struct {
+  char *base;       /* start of the mapping */
+  size_t size;      /* no. of bytes mapped */
+  size_t used;      /* no. of bytes handed out so far */
+  size_t page_size; /* size of the pages backing the mapping */
+  int thp;          /* transparent huge pages were requested */
+  int fd;           /* backing file with -DOUT_OF_CORE, -1 otherwise */
+} t_arena;
+
 /*
 ** function prototypes
 */
@@ -84,7 +151,7 @@ typedef struct {
 /* load params, allocate memory, load obstacles & initialise fluid particle
  * densities */
 int initialise(const char *paramfile, const char *obstaclefile, t_param *params,
-               t_speed **cells_ptr, t_speed **tmp_cells_ptr,
+               t_arena *arena, t_speed **cells_ptr, t_speed **tmp_cells_ptr,
                int **obstacles_ptr, float **av_vels_ptr);
 
 /*
@@ -99,7 +166,7 @@ int write_values(const t_param params, t_speed *cells, int *obstacles,
                  float *av_vels);
 
 /* finalise, including freeing up allocated memory */
-int finalise(const t_param *params, t_speed **cells_ptr,
+int finalise(const t_param *params, t_arena *arena, t_speed **cells_ptr,
              t_speed **tmp_cells_ptr, int **obstacles_ptr, float **av_vels_ptr);
 
 /* Sum all the densities in the grid.
@@ -112,6 +179,42 @@ float av_velocity(const t_param params, t_speed *cells, int *obstacles);
 /* calculate Reynolds number */
 float calc_reynolds(const t_param params, t_speed *cells, int *obstacles);
 
+/* map size bytes for the arena, reporting the pages obtained */
+void arena_reserve(t_arena *arena, size_t size);
+
+/* hand out the next size bytes of the arena, reporting where they lie */
+void *arena_carve(t_arena *arena, const char *name, size_t size);
+
+/* unmap the arena and everything carved from it */
+void arena_release(t_arena *arena);
+
+/* round size up to a whole number of ARENA_ALIGN blocks */
+size_t arena_round(size_t size);
+
+/* report how much of the arena transparent huge pages actually back, once
+** the buffers have been touched */
+void arena_report_thp(const t_arena *arena);
+
+#ifdef OUT_OF_CORE
+/* prefetch the next slab and release finished ones, called by timestep()
+** at the first row of each slab and with jj == ny once the step is done */
+void ooc_stream_slab(const t_param params, t_speed *cells, t_speed *tmp_cells,
+                     int *obstacles, int jj);
+
+/* page-aligned madvise() over the given rows of an array */
+void ooc_advise_rows(void *base, size_t row_bytes, int first_row, int last_row,
+                     int advice);
+
+/* unmap the given rows of an array and start writing them back; with evict
+** set, also wait for the write and drop them from the page cache */
+void ooc_release_rows(void *base, size_t row_bytes, int first_row,
+                      int last_row, int evict);
+
+/* the out-of-core arena, whose backing file ooc_release_rows() works on;
+** kept here so that timestep() has the same signature in every build */
+static t_arena *ooc_arena = NULL;
+#endif
+
 /* utility functions */
 void die(const char *message, const int line, const char *file);
 void usage(const char *exe);
@@ -119,11 +222,16 @@ void usage(const char *exe);
 /*
 ** main program:
 ** initialise, timestep loop, finalise
+**
+** Left out when built with -DNO_MAIN, so that the solver can be included
+** by another driver such as check/validate.c.
 */
+#ifndef NO_MAIN
 int main(int argc, char *argv[]) {
   char *paramfile = NULL;    /* name of the input parameter file */
   char *obstaclefile = NULL; /* name of a the input obstacle file */
   t_param params;            /* struct to hold parameter values */
+  t_arena arena;             /* single mapping holding the buffers below */
   t_speed *cells = NULL;     /* grid containing fluid densities */
   t_speed *tmp_cells = NULL; /* scratch space */
   int *obstacles = NULL;     /* grid indicating which cells are blocked */
@@ -146,8 +254,8 @@ int main(int argc, char *argv[]) {
   gettimeofday(&timstr, NULL);
   tot_tic = timstr.tv_sec + (timstr.tv_usec / 1000000.0);
   init_tic = tot_tic;
-  initialise(paramfile, obstaclefile, &params, &cells, &tmp_cells, &obstacles,
-             &av_vels);
+  initialise(paramfile, obstaclefile, &params, &arena, &cells, &tmp_cells,
+             &obstacles, &av_vels);
 
   /* Init time stops here, compute time starts*/
   gettimeofday(&timstr, NULL);
@@ -187,10 +295,11 @@ int main(int argc, char *argv[]) {
   printf("Elapsed Collate time:\t\t\t%.6lf (s)\n", col_toc - col_tic);
   printf("Elapsed Total time:\t\t\t%.6lf (s)\n", tot_toc - tot_tic);
   write_values(params, cells, obstacles, av_vels);
-  finalise(&params, &cells, &tmp_cells, &obstacles, &av_vels);
+  finalise(&params, &arena, &cells, &tmp_cells, &obstacles, &av_vels);
 
   return EXIT_SUCCESS;
 }
+#endif
 
 float timestep(const t_param params, t_speed *cells, t_speed *tmp_cells,
                int *obstacles) {
@@ -198,6 +307,10 @@ float timestep(const t_param params, t_speed *cells, t_speed *tmp_cells,
   int tot_cells = 0; /* no. of cells used in calculation */
   float tot_u = 0.f; /* accumulated magnitudes of velocity for each cell */
   for (int jj = 0; jj < params.ny; jj++) {
+#ifdef OUT_OF_CORE
+    if (jj % OOC_SLAB_ROWS == 0)
+      ooc_stream_slab(params, cells, tmp_cells, obstacles, jj);
+#endif
     for (int ii = 0; ii < params.nx; ii++) {
       // Propagate ------
       int y_n = (jj + 1) % params.ny;
@@ -338,6 +451,10 @@ float timestep(const t_param params, t_speed *cells, t_speed *tmp_cells,
       }
     }
   }
+#ifdef OUT_OF_CORE
+  /* release the last slabs of the step */
+  ooc_stream_slab(params, cells, tmp_cells, obstacles, params.ny);
+#endif
   return tot_u / (float)tot_cells;
 }
 
@@ -416,7 +533,7 @@ float av_velocity(const t_param params, t_speed *cells, int *obstacles) {
 }
 
 int initialise(const char *paramfile, const char *obstaclefile, t_param *params,
-               t_speed **cells_ptr, t_speed **tmp_cells_ptr,
+               t_arena *arena, t_speed **cells_ptr, t_speed **tmp_cells_ptr,
                int **obstacles_ptr, float **av_vels_ptr) {
   char message[1024]; /* message buffer */
   FILE *fp;           /* file pointer */
@@ -490,24 +607,31 @@ int initialise(const char *paramfile, const char *obstaclefile, t_param *params,
   ** a 1D array of these structs.
   */
 
-  /* main grid */
-  *cells_ptr = (t_speed *)malloc(sizeof(t_speed) * (params->ny * params->nx));
+  const size_t cells_bytes =
+      sizeof(t_speed) * ((size_t)params->ny * params->nx);
+  const size_t obstacles_bytes =
+      sizeof(int) * ((size_t)params->ny * params->nx);
+  const size_t av_vels_bytes = sizeof(float) * params->maxIters;
 
-  if (*cells_ptr == NULL)
-    die("cannot allocate memory for cells", __LINE__, __FILE__);
+  /* reserve everything at once, then carve out each buffer */
+  arena_reserve(arena, 2 * arena_round(cells_bytes) +
+                           arena_round(obstacles_bytes) +
+                           arena_round(av_vels_bytes));
 
-  /* 'helper' grid, used as scratch space */
-  *tmp_cells_ptr =
-      (t_speed *)malloc(sizeof(t_speed) * (params->ny * params->nx));
+  /* main grid */
+  *cells_ptr = (t_speed *)arena_carve(arena, "cells", cells_bytes);
 
-  if (*tmp_cells_ptr == NULL)
-    die("cannot allocate memory for tmp_cells", __LINE__, __FILE__);
+  /* 'helper' grid, used as scratch space */
+  *tmp_cells_ptr = (t_speed *)arena_carve(arena, "tmp_cells", cells_bytes);
 
   /* the map of obstacles */
-  *obstacles_ptr = malloc(sizeof(int) * (params->ny * params->nx));
+  *obstacles_ptr = (int *)arena_carve(arena, "obstacles", obstacles_bytes);
 
-  if (*obstacles_ptr == NULL)
-    die("cannot allocate column memory for obstacles", __LINE__, __FILE__);
+  /*
+  ** space to hold a record of the avarage velocities computed
+  ** at each timestep
+  */
+  *av_vels_ptr = (float *)arena_carve(arena, "av_vels", av_vels_bytes);
 
   /* initialise densities */
   float w0 = params->density * 4.f / 9.f;
@@ -568,31 +692,30 @@ int initialise(const char *paramfile, const char *obstaclefile, t_param *params,
   /* and close the file */
   fclose(fp);
 
-  /*
-  ** allocate space to hold a record of the avarage velocities computed
-  ** at each timestep
-  */
-  *av_vels_ptr = (float *)malloc(sizeof(float) * params->maxIters);
+#ifndef OUT_OF_CORE
+  /* fault in the scratch grid too, so its pages are in place for the
+  ** report and are not faulted in inside the timed loop.  Out of core this
+  ** would only dirty the whole file: ftruncate() already gave zeros */
+  memset(*tmp_cells_ptr, 0, cells_bytes);
+#endif
+
+  /* the grids have now been touched; av_vels is only written by the run */
+  arena_report_thp(arena);
 
   return EXIT_SUCCESS;
 }
 
-int finalise(const t_param *params, t_speed **cells_ptr,
+int finalise(const t_param *params, t_arena *arena, t_speed **cells_ptr,
              t_speed **tmp_cells_ptr, int **obstacles_ptr,
              float **av_vels_ptr) {
   /*
-  ** free up allocated memory
+  ** free up allocated memory: every buffer lives in the arena
   */
-  free(*cells_ptr);
-  *cells_ptr = NULL;
+  arena_release(arena);
 
-  free(*tmp_cells_ptr);
+  *cells_ptr = NULL;
   *tmp_cells_ptr = NULL;
-
-  free(*obstacles_ptr);
   *obstacles_ptr = NULL;
-
-  free(*av_vels_ptr);
   *av_vels_ptr = NULL;
 
   return EXIT_SUCCESS;
@@ -695,6 +818,288 @@ int write_values(const t_param params, t_speed *cells, int *obstacles,
   return EXIT_SUCCESS;
 }
 
+void arena_reserve(t_arena *arena, size_t size) {
+  const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  const char *pages; /* how the pages were obtained, for the report */
+  void *addr = MAP_FAILED;
+
+  arena->used = 0;
+  arena->page_size = page;
+  arena->thp = 0;
+  arena->fd = -1;
+
+#ifdef OUT_OF_CORE
+  char message[1024]; /* message buffer */
+
+  /* file pages are base pages: hugetlbfs and THP do not apply */
+  size = (size + page - 1) / page * page;
+
+  /* a unique name, so concurrent runs in one directory never share a file */
+  char path[] = OOC_FILE ".XXXXXX";
+  int fd = mkstemp(path);
+
+  if (fd == -1) {
+    sprintf(message, "could not create out-of-core backing file: %s", path);
+    die(message, __LINE__, __FILE__);
+  }
+
+  /* the space is released as soon as the arena is unmapped */
+  unlink(path);
+
+  if (ftruncate(fd, size) == -1)
+    die("cannot size out-of-core backing file", __LINE__, __FILE__);
+
+  addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+  if (addr == MAP_FAILED)
+    die("cannot map out-of-core backing file", __LINE__, __FILE__);
+
+  /* kept open for writeback and eviction of finished slabs */
+  arena->fd = fd;
+  ooc_arena = arena;
+  pages = "file-backed base pages";
+#else
+#ifndef NO_HUGE_PAGES
+  /* explicit huge pages, if the 2 MB hugetlbfs pool has enough free.  The
+  ** size is named, not left to the kernel default, which may be 1 GB */
+  const size_t huge_size =
+      (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+  addr = mmap(NULL, huge_size, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+
+  if (addr != MAP_FAILED) {
+    size = huge_size;
+    arena->page_size = HUGE_PAGE_SIZE;
+    pages = "explicit huge pages";
+  } else {
+    /* base pages: over-map so a huge page aligned range can be kept, giving
+    ** transparent huge pages a chance to back the whole arena */
+    char *raw = mmap(NULL, huge_size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (raw == MAP_FAILED)
+      die("cannot map memory for arena", __LINE__, __FILE__);
+
+    char *aligned =
+        (char *)(((uintptr_t)raw + HUGE_PAGE_SIZE - 1) &
+                 ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+
+    if (aligned > raw)
+      munmap(raw, aligned - raw);
+
+    if (raw + HUGE_PAGE_SIZE > aligned)
+      munmap(aligned + huge_size, raw + HUGE_PAGE_SIZE - aligned);
+
+    addr = aligned;
+    size = huge_size;
+    arena->thp = (madvise(addr, size, MADV_HUGEPAGE) == 0);
+    pages = arena->thp
+                ? "base pages, transparent huge pages requested"
+                : "base pages, huge pages unavailable";
+  }
+#else
+  size = (size + page - 1) / page * page;
+  addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+              -1, 0);
+
+  if (addr == MAP_FAILED)
+    die("cannot map memory for arena", __LINE__, __FILE__);
+
+  pages = "base pages";
+#endif
+#endif
+
+  arena->base = (char *)addr;
+  arena->size = size;
+
+#ifdef NUMA_INTERLEAVE
+  /* interleave across every node the process may use; the kernel masks out
+  ** the ones it may not.  Must happen before the first touch */
+  unsigned long nodemask = ~0UL;
+
+  if (syscall(SYS_mbind, arena->base, arena->size, MPOL_INTERLEAVE, &nodemask,
+              sizeof(nodemask) * 8, 0) != 0)
+    fprintf(stderr, "warning: NUMA interleave unavailable, using default "
+                    "placement\n");
+#endif
+
+  /* with transparent huge pages this is only the base page size; the
+  ** pages obtained are reported by arena_report_thp() */
+  printf("Arena: %zu bytes at %p, %zu byte %s\n", arena->size,
+         (void *)arena->base, arena->page_size, pages);
+}
+
+void *arena_carve(t_arena *arena, const char *name, size_t size) {
+  char *addr = arena->base + arena->used;
+
+  if (arena->used + arena_round(size) > arena->size)
+    die("arena too small", __LINE__, __FILE__);
+
+  arena->used += arena_round(size);
+
+  printf("  %-10s offset %12zu, %12zu bytes\n", name,
+         (size_t)(addr - arena->base), size);
+
+  return addr;
+}
+
+void arena_release(t_arena *arena) {
+  if (munmap(arena->base, arena->size) != 0)
+    die("cannot unmap arena", __LINE__, __FILE__);
+
+  if (arena->fd != -1)
+    close(arena->fd);
+
+#ifdef OUT_OF_CORE
+  ooc_arena = NULL;
+#endif
+  arena->fd = -1;
+  arena->base = NULL;
+  arena->size = arena->used = 0;
+}
+
+size_t arena_round(size_t size) {
+  return (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+}
+
+void arena_report_thp(const t_arena *arena) {
+  const unsigned long start = (unsigned long)arena->base;
+  const unsigned long end = start + arena->size;
+  char line[256];       /* line buffer */
+  unsigned long lo, hi; /* address range of a mapping in smaps */
+  size_t kb;            /* AnonHugePages of that mapping */
+  size_t thp_bytes = 0; /* bytes of the arena on transparent huge pages */
+  int inside = 0;       /* current smaps entry overlaps the arena */
+  FILE *fp;             /* file pointer */
+
+  if (!arena->thp)
+    return;
+
+  fp = fopen("/proc/self/smaps", "r");
+
+  if (fp == NULL) {
+    printf("Arena: transparent huge page usage unknown\n");
+    return;
+  }
+
+  /* the kernel may split or merge the arena's mapping, so add up every
+  ** entry overlapping it */
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    if (sscanf(line, "%lx-%lx ", &lo, &hi) == 2)
+      inside = (lo < end && hi > start);
+    else if (inside && sscanf(line, "AnonHugePages: %zu kB", &kb) == 1)
+      thp_bytes += kb * 1024;
+  }
+
+  fclose(fp);
+
+  printf("Arena: %zu of %zu bytes on %d byte transparent huge pages, the "
+         "rest on %zu byte pages\n",
+         thp_bytes, arena->size, HUGE_PAGE_SIZE, arena->page_size);
+}
+
+#ifdef OUT_OF_CORE
+void ooc_stream_slab(const t_param params, t_speed *cells, t_speed *tmp_cells,
+                     int *obstacles, int jj) {
+  const size_t cell_row = sizeof(t_speed) * params.nx;
+  const size_t obstacle_row = sizeof(int) * params.nx;
+  const int next = jj + OOC_SLAB_ROWS;
+  const int prev = jj - OOC_SLAB_ROWS; /* start of the slab just finished */
+
+  if (jj == 0) {
+    /* first slab of the step, plus the wrapped south halo in the top row */
+    const int last = (OOC_SLAB_ROWS < params.ny ? OOC_SLAB_ROWS : params.ny) - 1;
+    const int halo = (last + 1 < params.ny) ? last + 1 : last;
+    ooc_advise_rows(cells, cell_row, 0, halo, MADV_WILLNEED);
+    ooc_advise_rows(cells, cell_row, params.ny - 1, params.ny - 1,
+                    MADV_WILLNEED);
+    ooc_advise_rows(obstacles, obstacle_row, 0, last, MADV_WILLNEED);
+  }
+
+  if (next < params.ny) {
+    /* read ahead the next slab and its north halo while this one computes,
+    ** the last slab's north halo being the wrapped bottom row.  tmp_cells
+    ** is not prefetched: the slab overwrites it completely */
+    const int last =
+        (next + OOC_SLAB_ROWS < params.ny ? next + OOC_SLAB_ROWS : params.ny) -
+        1;
+    const int halo = (last + 1 < params.ny) ? last + 1 : 0;
+    ooc_advise_rows(cells, cell_row, next, last, MADV_WILLNEED);
+    ooc_advise_rows(cells, cell_row, halo, halo, MADV_WILLNEED);
+    ooc_advise_rows(obstacles, obstacle_row, next, last, MADV_WILLNEED);
+  }
+
+  if (jj == params.ny) {
+    /* end of the step: the last two tmp_cells slabs are still dirty, and a
+    ** few rows of cells were kept as halos, so sweep all three grids */
+    ooc_release_rows(cells, cell_row, 0, params.ny - 1, 1);
+    ooc_release_rows(tmp_cells, cell_row, 0, params.ny - 1, 1);
+    ooc_release_rows(obstacles, obstacle_row, 0, params.ny - 1, 1);
+  } else if (prev >= 0) {
+    /* the previous slab is done; row jj-1 is still this slab's south halo.
+    ** cells and obstacles were only read, so they are clean and go now */
+    ooc_release_rows(cells, cell_row, prev, jj - 2, 1);
+    ooc_release_rows(obstacles, obstacle_row, prev, jj - 1, 1);
+
+    /* tmp_cells is dirty: start writing it back now, and evict it one slab
+    ** later, once the write has had a slab's compute time to complete */
+    ooc_release_rows(tmp_cells, cell_row, prev, jj - 1, 0);
+
+    if (prev - OOC_SLAB_ROWS >= 0)
+      ooc_release_rows(tmp_cells, cell_row, prev - OOC_SLAB_ROWS, prev - 1,
+                       1);
+  }
+}
+
+void ooc_advise_rows(void *base, size_t row_bytes, int first_row, int last_row,
+                     int advice) {
+  const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+  uintptr_t start = (uintptr_t)base + row_bytes * first_row;
+  uintptr_t end = (uintptr_t)base + row_bytes * (last_row + 1);
+
+  if (last_row < first_row)
+    return;
+
+  if (advice == MADV_DONTNEED) {
+    /* shrink to whole pages so rows still in use are not dropped */
+    start = (start + page - 1) & ~(page - 1);
+    end &= ~(page - 1);
+  } else {
+    /* grow to whole pages so the rows are fully covered */
+    start &= ~(page - 1);
+    end = (end + page - 1) & ~(page - 1);
+  }
+
+  /* only a hint: failures cost performance, not correctness */
+  if (start < end)
+    madvise((void *)start, end - start, advice);
+}
+
+void ooc_release_rows(void *base, size_t row_bytes, int first_row,
+                      int last_row, int evict) {
+  const off_t offset = (char *)base + row_bytes * first_row - ooc_arena->base;
+  const off_t len = row_bytes * (last_row - first_row + 1);
+
+  if (last_row < first_row)
+    return;
+
+  /* pages still mapped can not leave the page cache */
+  ooc_advise_rows(base, row_bytes, first_row, last_row, MADV_DONTNEED);
+
+  /* failures here cost memory, not correctness */
+  if (evict) {
+    /* dirty pages are skipped by POSIX_FADV_DONTNEED, so wait for them */
+    sync_file_range(ooc_arena->fd, offset, len,
+                    SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                        SYNC_FILE_RANGE_WAIT_AFTER);
+    posix_fadvise(ooc_arena->fd, offset, len, POSIX_FADV_DONTNEED);
+  } else {
+    sync_file_range(ooc_arena->fd, offset, len, SYNC_FILE_RANGE_WRITE);
+  }
+}
+#endif
+
 void die(const char *message, const int line, const char *file) {
   fprintf(stderr, "Error at line %d of file %s:\n", line, file);
   fprintf(stderr, "%s\n", message);